@@ -13,6 +13,10 @@
 #include <string.h>
 #include <math.h>
 #include <complex.h>
+#include <limits.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 #define MAXCOLUMN 8
 
@@ -394,49 +398,102 @@ void nucomplex(Real *tptr, Complex *xptr, int *nptr, int *ncoeffptr, int *noctav
 }
 
 
+/* Exact wavelet transform with a Hanning window of radius pi/(sigma*omega).
+ * The coefficient is the weighted least squares fit of nureal, i.e.
+ * 2/(W^2-|iota|^2)*(W*conj(zeta)-conj(iota)*zeta) with the weight sum W, which
+ * reduces to nureal for a flat window. Note that fastnurealwavelet does not
+ * approximate this yet: its final combination uses cnt+iota0 in place of W and
+ * adds zeta*conj(iota) instead of subtracting it, so the two currently disagree
+ * and this routine cannot validate it until that is fixed.
+ * The abscissae have to be ordered in t.
+ * For each frequency, the window slides across the uniform time grid with two
+ * pointers to its first and past its last sample; the phase factors
+ * exp(-i omega t_k) and exp(-i sigma omega t_k) of each sample are computed once
+ * when it enters the window, so that the sums within a window only take
+ * multiplications with the factors of the window center t.
+ * The result holds ncoeff*noctave*tsubdiv coefficients, the time points of one
+ * frequency being adjacent. The frequencies are distributed over OpenMP threads.
+ * *statusptr is set to 0 on success and to 1 if the phase factor buffers could not
+ * be allocated, in which case the result is left untouched.
+ */
 #ifdef _STANDALONE_
 void nurealwavelet()
 {
 #else
 void nurealwavelet(Real *tptr, Real *xptr, int *nptr, double *lengthptr, int *ncoeffptr, int *noctaveptr,
-		       double *tminptr, double *tmaxptr, int *tsubdivptr, Real *sigmaptr, Real *omegamaxptr, Complex *result)
+		       double *tminptr, double *tmaxptr, int *tsubdivptr, Real *sigmaptr, Real *omegamaxptr, Complex *result,
+		       int *statusptr)
 {
 #endif
-    int     j, k, /* n = *nptr, */ ncoeff = *ncoeffptr, noctave = *noctaveptr, tsubdiv = *tsubdivptr, cnt;
+    int     k, nthread = 1, n = *nptr, ncoeff = *ncoeffptr, nfreq = ncoeff * *noctaveptr, tsubdiv = *tsubdivptr;
     Real    omegamax = *omegamaxptr,
-	    tmin = *tminptr, tmax = *tmaxptr, deltat = (tmax-tmin)/(*tsubdivptr-1), sigma = *sigmaptr,
-	    o, omul = exp(-M_LN2/ncoeff), omul_1 = 1.0/omul, ot,
-	    winrad = M_PI/(sigma*omegamax),			     /* abscissa dist. from Hanning window center to its borders */
-	    *xp, *tp, *xq, *tq, dt, t, iota0, sot, w;
-    Complex *rp = result, iota, zeta;
-
-    for(o = omegamax, k = ncoeff*noctave; k--; o *= omul, winrad *= omul_1)
-	for(tp = tptr, xp = xptr, t = tmin, j = tsubdiv; j--; t += deltat)
-	{   for( ;(dt = t-*(tq = tp+1)) < winrad; tp++, xp++);
-	    for(tq = tp, xq = xq, cnt = 0, zeta = iota0 = iota = 0; (sot = sigma*(ot = o*(*tq-t))) < M_PI; cnt++)
-	    {   w = 0.5*(1+cos(sot)); iota0+=w;
-		RE(zeta) += w*cos(ot); IM(zeta) += w*sin(ot);
-		ot *= 2;
-		RE(iota) += w*cos(ot); IM(zeta) += w*sin(ot);
+	    tmin = *tminptr, tmax = *tmaxptr, deltat = tsubdiv > 1 ? (tmax-tmin)/(tsubdiv-1) : 0, sigma = *sigmaptr;
+    Complex *phbuf;			/* exp(-i omega t_k), exp(-i sigma omega t_k) per thread */
+
+#ifdef _OPENMP
+    nthread = omp_get_max_threads();
+#endif
+    if(!(phbuf = malloc(2*(size_t)(n > 0 ? n : 1)*nthread*sizeof(Complex))))
+    {   *statusptr = 1; return;   }
+    *statusptr = 0;
+
+#ifdef _OPENMP
+#pragma omp parallel num_threads(nthread)
+#endif
+    {   Complex *ph = phbuf,
+		*rp, zeta, iota, g, gs;
+	Real    omega, winrad, t, w, wx, er, ei, iota0, d, tmp;
+	int     j, lo, hi, ki;
+
+#ifdef _OPENMP
+	ph += 2*(size_t)n*omp_get_thread_num();
+#pragma omp for schedule(dynamic)
+#endif
+	for(k = 0; k < nfreq; k++)
+	{   omega  = omegamax*exp(-k*M_LN2/ncoeff);
+	    winrad = M_PI/(sigma*omega);	/* abscissa dist. from Hanning window center to its borders */
+	    /*** Results per time point ***/
+	    for(rp = result+(size_t)k*tsubdiv, t = tmin, j = 0, lo = hi = 0; j < tsubdiv; j++, t = tmin+j*deltat)
+	    {   for( ; lo < n && tptr[lo] <= t-winrad; lo++) {}
+		for(hi = hi < lo ? lo : hi; hi < n && tptr[hi] < t+winrad; hi++)
+		{   PHISET(ph[2*hi], -omega*tptr[hi]); PHISET(ph[2*hi+1], -sigma*omega*tptr[hi]);   }
+		PHISET(g, omega*t); PHISET(gs, sigma*omega*t);
+		for(zeta = iota = 0, iota0 = 0, ki = lo; ki < hi; ki++)
+		{   /* exp(-i omega (t_k-t)) and the Hanning weight, spelled out to avoid complex library calls */
+		    er = RE(ph[2*ki])*RE(g)-IM(ph[2*ki])*IM(g); ei = RE(ph[2*ki])*IM(g)+IM(ph[2*ki])*RE(g);
+		    w = 0.5*(1+RE(ph[2*ki+1])*RE(gs)-IM(ph[2*ki+1])*IM(gs)); iota0 += w;
+		    wx = w*xptr[ki];
+		    RE(zeta) += wx*er; IM(zeta) += wx*ei;
+		    RE(iota) += w*(er*er-ei*ei); IM(iota) += 2*w*er*ei;
+		}
+		if(hi-lo > 1 && (d = sqr(iota0)-sqr(RE(iota))-sqr(IM(iota))) > 0)
+		    *rp++ = 2/d*(iota0*conj(zeta)-conj(iota)*zeta);
+		else
+		    *rp++ = 0;
 	    }
-	    if(cnt>0)
-		*rp++ = 2/(sqr(cnt+iota0)-sqr(RE(iota))-sqr(IM(iota)))*(conj(zeta)*iota0+zeta*conj(iota));
-	    else
-		*rp++ = 0;
-	    *rp++ = 0;
 	}
+    }
+    free(phbuf);
 }
 
+/* Common part of fastnurealwavelet and fastnurealwavelettiled.
+ * tsubdivptr points to the number of translation values of the first frequency;
+ * it is advanced by tsubdivinc after each frequency, i.e. with tsubdivinc = 0
+ * every frequency uses the same time grid, with tsubdivinc = 1 tsubdivptr is an
+ * array holding one count per frequency. The result for each frequency consists of
+ * that many values evenly spaced between tmin and tmax.
+ */
 #ifdef _STANDALONE_
-void fastnurealwavelet()
+static void fastnurealwaveletcore()
 {
 #else
-void fastnurealwavelet(Real *tptr, Real *xptr, int *nptr, double *lengthptr, int *ncoeffptr, int *noctaveptr,
-		       double *tminptr, double *tmaxptr, int *tsubdivptr, Real *sigmaptr, Real *omegamaxptr, Complex *result)
+static void fastnurealwaveletcore(Real *tptr, Real *xptr, int *nptr, double *lengthptr, int *ncoeffptr, int *noctaveptr,
+				  double *tminptr, double *tmaxptr, int *tsubdivptr, int tsubdivinc,
+				  Real *sigmaptr, Real *omegamaxptr, Complex *result)
 {
     int  k, n = *nptr, ncoeff = *ncoeffptr, noctave = *noctaveptr;
     Real length = *lengthptr, omegamax = *omegamaxptr,
-	 tmin = *tminptr, tmax = *tmaxptr, deltat = (tmax-tmin)/(*tsubdivptr-1), sigma = *sigmaptr;
+	 tmin = *tminptr, tmax = *tmaxptr, deltat, sigma = *sigmaptr;
 #endif
     struct SumVec			     /* Precomputation record */
     {   struct SumVec *next;		     /* A singly linked list */
@@ -502,10 +559,11 @@ void fastnurealwavelet(Real *tptr, Real *xptr, int *nptr, double *lengthptr, int
     /*** Loop over Octaves ***/
     for(j = noctave, tau0d = tau0, winrad = M_PI/(sigma*omegaoct); ; ooct *= 0.5, omegaoct *= 0.5, tau0d += dtaud, dtaud *= 2)
     {   /*** Results per frequency ***/
-        for(i = ncoeff, o = ooct, omega = omegaoct; i--; o *= omul, omega *= omul, winrad *= omul_1)
+        for(i = ncoeff, o = ooct, omega = omegaoct; i--; o *= omul, omega *= omul, winrad *= omul_1, tsubdivptr += tsubdivinc)
         {   oplus  = o+sigma; ominus  = o-sigma;
 	    o2plus = oplus+o; o2minus = ominus+o;
 	    osigma = o*sigma;
+	    deltat = (tmax-tmin)/(*tsubdivptr-1);
 	    /*** Results per time point ***/
 	    for(t = tmin, ti = *tsubdivptr, sp = shead; ti--; t += deltat)
             {   zeta = iota = iota0 = 0;
@@ -617,6 +675,28 @@ void fastnurealwavelet(Real *tptr, Real *xptr, int *nptr, double *lengthptr, int
     }
 }
 
+#ifndef _STANDALONE_
+/* Wavelet transform on a uniform time grid of *tsubdivptr translation values
+ * for every frequency; the result has ncoeff*noctave*tsubdiv elements.
+ */
+void fastnurealwavelet(Real *tptr, Real *xptr, int *nptr, double *lengthptr, int *ncoeffptr, int *noctaveptr,
+		       double *tminptr, double *tmaxptr, int *tsubdivptr, Real *sigmaptr, Real *omegamaxptr, Complex *result)
+{   fastnurealwaveletcore(tptr, xptr, nptr, lengthptr, ncoeffptr, noctaveptr, tminptr, tmaxptr,
+			  tsubdivptr, 0, sigmaptr, omegamaxptr, result);
+}
+
+/* Scale-adaptive tiling of the time axis: tsubdivptr holds ncoeff*noctave
+ * counts, one per frequency in the order of the result, so that the time step can
+ * follow the window radius. The coefficients of all frequencies are stored
+ * back to back; the result needs the sum of the counts as elements.
+ */
+void fastnurealwavelettiled(Real *tptr, Real *xptr, int *nptr, double *lengthptr, int *ncoeffptr, int *noctaveptr,
+			    double *tminptr, double *tmaxptr, int *tsubdivptr, Real *sigmaptr, Real *omegamaxptr, Complex *result)
+{   fastnurealwaveletcore(tptr, xptr, nptr, lengthptr, ncoeffptr, noctaveptr, tminptr, tmaxptr,
+			  tsubdivptr, 1, sigmaptr, omegamaxptr, result);
+}
+#endif
+
 #ifdef _STANDALONE_
 void nureal(Data *in, int ct, int cx, int n, int ncoeff, int noctave, Real omegamax, Complex *rp)
 {   Data *dp;
@@ -640,6 +720,371 @@ void nureal(Real *tptr, Real *xptr, int *nptr, int *ncoeffptr, int *noctaveptr,
     }
 }
 
+/* Precomputation blocks for the band limited, autotuned and sliding window variants
+ * of fastnureal.
+ * In contrast to the linked lists above, the blocks are kept in an array indexed
+ * by their position on the abscissa: block h covers [tmin+2*h*dtau, tmin+2*(h+1)*dtau)
+ * and is centered at tau_h = tmin+(2*h+1)*dtau; blocks into which no sample falls
+ * have cnt == 0. The elements are the Taylor coefficients x*u^p/p! and u^p/p! of
+ * exp(u z) with u = mu*(t-tau_h), so that moving the center by d amounts to a
+ * multiplication with the power series of exp(-mu d z).
+ */
+typedef struct
+{   XTElem elems[PNUM];			/* the summed power series elements */
+    int cnt;				/* number of samples for which the elements were added */
+} XTBlock;
+
+/* Subdivision and Precomputation for the samples with tmin <= t <= tmax,
+ * which need not be ordered in t; samples outside that range are skipped.
+ * The block of a sample is only looked up when it leaves the block of the
+ * previous one, which makes ordered input as cheap as in fastnureal.
+ * Returns a malloc'ed array of *nbptr blocks, or 0 if it cannot be allocated.
+ */
+static XTBlock *xtsubdivide(Real *tptr, Real *xptr, int n, Real tmin, Real tmax, Real dtau, Real mu, int *nbptr)
+{   XTBlock *b, *sp;
+    XTElem  *p;
+    Real    x, tau, ts, te,		/* center and borders of the current block */
+	    dtau2_1 = 0.5/dtau, nbd = floor((tmax-tmin)*dtau2_1)+1;
+    int     h, k, nb;
+
+    if(!(nbd < INT_MAX/2) || !(b = calloc(nb = (int)nbd, sizeof(*b))))
+	return 0;
+    for(k = 0, sp = b, ts = tmin, te = tmin+2*dtau, tau = tmin+dtau; k < n; k++)
+    {   if(tptr[k] < tmin || tptr[k] > tmax) continue;
+	if(tptr[k] < ts || tptr[k] >= te)	/* only look up the block when leaving the current one */
+	{   if((h = (int)((tptr[k]-tmin)*dtau2_1)) >= nb) h = nb-1;
+	    sp = b+h; ts = tmin+2*h*dtau; te = ts+2*dtau; tau = ts+dtau;
+	}
+	x = xptr[k];
+	EXPIOT_SERIES(p, sp->elems, mu*(tptr[k]-tau), +=, SETXT, SETXT);
+	sp->cnt++;
+    }
+    *nbptr = nb;
+    return b;
+}
+
+/* Merging of adjacent blocks of radius dtaud into blocks of radius 2*dtaud;
+ * block 2h is centered at tau-dtaud and block 2h+1 at tau+dtaud relative to the
+ * center tau of the merged block h. Returns the new number of blocks.
+ */
+static int xtmerge(XTBlock *b, int nb, Real dtaud, Real mu)
+{   Real    dl[PNUM], dr[PNUM];		/* power series elements of exp(-mu dtaud z), exp(mu dtaud z) */
+    XTElem  s[PNUM];
+    XTBlock *l, *r;
+    int     h, i, j;
+
+    for(dl[0] = dr[0] = 1, i = 1; i < PNUM; i++)
+    {   dr[i] = dr[i-1]*mu*dtaud/i; dl[i] = (i&1) ? -dr[i] : dr[i];   }
+    for(h = 0; 2*h < nb; h++)
+    {   l = b+2*h; r = 2*h+1 < nb ? l+1 : 0;
+	for(i = 0; i < PNUM; i++)
+	{   s[i].x = s[i].t = 0;
+	    if(l->cnt)
+		for(j = 0; j <= i; j++)
+		{   s[i].x += l->elems[j].x*dl[i-j]; s[i].t += l->elems[j].t*dl[i-j];   }
+	    if(r && r->cnt)
+		for(j = 0; j <= i; j++)
+		{   s[i].x += r->elems[j].x*dr[i-j]; s[i].t += r->elems[j].t*dr[i-j];   }
+	}
+	memcpy(b[h].elems, s, sizeof(s));
+	b[h].cnt = l->cnt+(r ? r->cnt : 0);
+    }
+    return (nb+1)/2;
+}
+
+/* Per frequency tables for xtsum, independent of the block position */
+typedef struct
+{   Complex op[PNUM], o2p[PNUM],	/* (-i omega/mu)^p, (-2 i omega/mu)^p */
+	    emul, e2mul;		/* phase steps exp(-2 i omega dtaud), exp(-4 i omega dtaud) between blocks */
+} XTFreq;
+
+static void xtfreq(XTFreq *f, Real omega, Real dtaud, Real mu)
+{   Real    tmp, o = omega/mu;
+    int     i;
+
+    for(f->op[0] = f->o2p[0] = 1, i = 1; i < PNUM; i++)
+    {   CSET(f->op[i],  IM(f->op[i-1])*o,    -RE(f->op[i-1])*o);
+	CSET(f->o2p[i], IM(f->o2p[i-1])*2*o, -RE(f->o2p[i-1])*2*o);
+    }
+    PHISET(f->emul, -2*omega*dtaud); f->e2mul = f->emul*f->emul;
+}
+
+/* Adds the contributions of nb consecutive blocks to the accumulators zeta and
+ * iota; e = exp(-i omega tau) is the phase at the center tau of the first block.
+ */
+static void xtsum(XTBlock *b, int nb, Complex e, const XTFreq *f, Complex *zeta, Complex *iota)
+{   Complex e2 = e*e, zz, ii;
+    XTElem  *p;
+    int     i;
+
+    for( ; nb-- > 0; b++, e *= f->emul, e2 *= f->e2mul)
+	if(b->cnt)
+	{   for(zz = ii = 0, p = b->elems, i = 0; i < PNUM; i++, p++)
+	    {   zz += p->x*f->op[i]; ii += p->t*f->o2p[i];   }
+	    *zeta += e*zz; *iota += e2*ii;
+	}
+}
+
+/* Adds the contributions of nb consecutive blocks of radius dtaud, the first
+ * one centered at tau, to the accumulators zeta and iota of frequency omega.
+ */
+static void xtaccum(XTBlock *b, int nb, Real tau, Real dtaud, Real omega, Real mu, Complex *zeta, Complex *iota)
+{   XTFreq  f;
+    Complex e;
+    Real    tmp;
+
+    xtfreq(&f, omega, dtaud, mu);
+    PHISET(e, -omega*tau);
+    xtsum(b, nb, e, &f, zeta, iota);
+}
+
+/* The spectral coefficient from the accumulated sums over cnt samples, as in nureal */
+static Complex xtrealcoeff(Complex zeta, Complex iota, int cnt)
+{   Real n_1 = 1.0/cnt;
+
+    zeta *= n_1; iota *= n_1;
+    return 2/(1-sqr(RE(iota))-sqr(IM(iota)))*(conj(zeta)-conj(iota)*zeta);
+}
+
+/* Band limited variant of fastnureal: nfreq coefficients for frequencies
+ * logarithmically spaced from omegamax down to omegamin. The initial blocks are
+ * chosen for omegamax rather than for the top of the whole spectrum, and only
+ * those merging steps are done that are needed to descend to omegamin.
+ * The bounds are swapped if given in reverse order; if either of them is not
+ * positive, the result is left untouched.
+ */
+void fastnurealband(Real *tptr, Real *xptr, int *nptr, double *lengthptr,
+		    Real *omegaminptr, Real *omegamaxptr, int *nfreqptr, Complex *rp)
+{   int     k, nb, n = *nptr, nfreq = *nfreqptr;
+    Real    omegamin = *omegaminptr, omegamax = *omegamaxptr, omegaoct, omega, omul,
+	    dtaud,				/* precomputation interval radius */
+	    mu = (0.5*M_PI)/ *lengthptr,
+	    tmin, tmax, tau0;
+    Complex zeta, iota;
+    XTBlock *b;
+
+    if(n <= 0 || !(omegamin > 0) || !(omegamax > 0)) return;
+    if(omegamin > omegamax)
+    {   omega = omegamin; omegamin = omegamax; omegamax = omega;   }
+    omegaoct = omegamax;
+    omul = nfreq > 1 ? exp(log(omegamin/omegamax)/(nfreq-1)) : 1;
+    dtaud = (0.5*M_PI)/omegamax;
+    for(tmin = tmax = tptr[0], k = 1; k < n; k++)
+    {   if(tptr[k] < tmin) tmin = tptr[k];
+	if(tptr[k] > tmax) tmax = tptr[k];
+    }
+    if(!(b = xtsubdivide(tptr, xptr, n, tmin, tmax, dtaud, mu, &nb))) return;
+    for(tau0 = tmin+dtaud, omega = omegamax; nfreq--; omega *= omul)
+    {   for( ; 2*omega <= omegaoct; omegaoct *= 0.5, tau0 += dtaud, dtaud *= 2)
+	    nb = xtmerge(b, nb, dtaud, mu);
+	zeta = iota = 0;
+	xtaccum(b, nb, tau0, dtaud, omega, mu, &zeta, &iota);
+	*rp++ = xtrealcoeff(zeta, iota, n);
+    }
+    free(b);
+}
+
+/* Rough costs, in units of stepping over one precomputation block, of summing one
+ * sample exactly (sin and cos), of evaluating the power series of one occupied
+ * block and of expanding one sample into a power series. Used by fastnurealauto
+ * to choose between exact summation and the block scheme.
+ */
+#define XT_EXACTCOST  6
+#define XT_BLOCKCOST  1
+#define XT_ELEMCOST   7
+#define XT_SAMPLECOST 4
+#define XT_MAXREFINE  1			/* max. number of halvings of the initial block radius */
+
+/* Number of blocks of radius dtau starting at tmin that contain samples;
+ * exact for ordered abscissae, an upper bound otherwise. If the block indices
+ * would not fit into an int, n is returned as the upper bound.
+ */
+static int xtoccupied(Real *tptr, int n, Real tmin, Real tmax, Real dtau)
+{   int  k, h, last, cnt;
+    Real dtau2_1 = 0.5/dtau;
+
+    if(!((tmax-tmin)*dtau2_1 < INT_MAX/2))
+	return n;
+    for(k = cnt = 0, last = -1; k < n; k++)
+	if((h = (int)((tptr[k]-tmin)*dtau2_1)) != last)
+	{   last = h; cnt++;   }
+    return cnt;
+}
+
+/* Estimated cost of evaluating one frequency from the blocks of radius dtau */
+static Real xtcost(Real *tptr, int n, Real tmin, Real tmax, Real dtau)
+{   return (floor((tmax-tmin)/(2*dtau))+1)*XT_BLOCKCOST+(Real)xtoccupied(tptr, n, tmin, tmax, dtau)*XT_ELEMCOST;
+}
+
+/* fastnureal with a block radius chosen from the distribution of the abscissae.
+ * Top octaves for which the blocks would be mostly empty or hold single samples
+ * are summed exactly as in nureal; the remaining ones use the block scheme. For densely sampled data, the initial
+ * radius is halved as long as evaluating all block octaves stays cheaper than
+ * the precomputation, which makes the truncated series more accurate.
+ * The choice is reported in *nexactptr (number of exactly summed octaves) and
+ * *dtauptr (initial block radius). The blocks are merged once per octave, so
+ * *nmergeptr is not a choice but follows as noctave-nexact-1 (0 if no block
+ * octaves remain). *statusptr is set to 1 if the blocks cannot be allocated;
+ * the block octaves are then left at 0 and *dtauptr is 0.
+ */
+void fastnurealauto(Real *tptr, Real *xptr, int *nptr, double *lengthptr, int *ncoeffptr, int *noctaveptr,
+		    Real *omegamaxptr, Complex *rp, int *nexactptr, Real *dtauptr, int *nmergeptr, int *statusptr)
+{   int     i, j, k, nb, nexact, nmerge = 0,
+	    n = *nptr, ncoeff = *ncoeffptr, noctave = *noctaveptr;
+    Real    omegamax = *omegamaxptr, omegaoct, omega, omul = exp(-M_LN2/ncoeff),
+	    mu = (0.5*M_PI)/ *lengthptr,
+	    tmin, tmax, tau0, dtau, dtaud, ot, tmp;
+    Complex zeta, iota, e;
+    XTBlock *b = 0;
+
+    *nexactptr = *nmergeptr = *statusptr = 0; *dtauptr = 0;
+    if(n <= 0) return;
+    for(tmin = tmax = tptr[0], k = 1; k < n; k++)
+    {   if(tptr[k] < tmin) tmin = tptr[k];
+	if(tptr[k] > tmax) tmax = tptr[k];
+    }
+    /* Exact summation as long as it is cheaper than the blocks at that level */
+    for(nexact = 0, dtau = (0.5*M_PI)/omegamax; nexact < noctave; nexact++, dtau *= 2)
+	if(xtcost(tptr, n, tmin, tmax, dtau) < (Real)n*XT_EXACTCOST)
+	    break;
+    /* Refinement of densely populated blocks; the octaves below cost about as much again */
+    if(nexact < noctave)
+	for(i = 0; i < XT_MAXREFINE && 2.0*ncoeff*xtcost(tptr, n, tmin, tmax, 0.5*dtau) <= (Real)n*XT_SAMPLECOST; i++)
+	    dtau *= 0.5;
+
+    /*** Exactly summed octaves ***/
+    for(j = 0, omegaoct = omegamax; j < nexact; j++, omegaoct *= 0.5)
+	for(i = ncoeff, omega = omegaoct; i--; omega *= omul)
+	{   for(zeta = iota = 0, k = 0; k < n; k++)
+	    {   ot = -omega*tptr[k]; PHISET(e, ot);
+		zeta += e*xptr[k]; iota += e*e;
+	    }
+	    *rp++ = xtrealcoeff(zeta, iota, n);
+	}
+
+    /*** Octaves from the blocks ***/
+    if(nexact >= noctave)
+	dtau = 0;
+    else if(!(b = xtsubdivide(tptr, xptr, n, tmin, tmax, dtau, mu, &nb)))
+    {   dtau = 0; *statusptr = 1;   }
+    else
+	for(tau0 = tmin+dtau, dtaud = dtau; ; omegaoct *= 0.5, tau0 += dtaud, dtaud *= 2)
+	{   for(i = ncoeff, omega = omegaoct; i--; omega *= omul)
+	    {   zeta = iota = 0;
+		xtaccum(b, nb, tau0, dtaud, omega, mu, &zeta, &iota);
+		*rp++ = xtrealcoeff(zeta, iota, n);
+	    }
+	    if(++j >= noctave) break;	    /* avoid unnecessary merging at the end */
+	    nb = xtmerge(b, nb, dtaud, mu); nmerge++;
+	}
+    free(b);
+    *nexactptr = nexact; *dtauptr = dtau; *nmergeptr = nmerge;
+}
+
+/* Short-time spectra of fastnureal over windows of length *winlenptr starting at
+ * tmin, tmin+hop, ..., one spectrum of ncoeff*noctave coefficients per window.
+ * The blocks are laid out such that both hop and window length are multiples of
+ * the block width, so that each window consists of whole blocks; their number per
+ * hop is a power of two, which allows using merged blocks for the lower octaves as
+ * long as they stay aligned. Since the sums over blocks are additive, the sums of
+ * each frequency are kept running: moving the window adds the blocks entering at
+ * the leading edge and subtracts the ones leaving at the trailing edge, so the cost
+ * per window is proportional to the hop rather than the window length.
+ * The window length is rounded to a multiple of the block width; the value used is
+ * written back to *winlenptr. Windows with fewer than two samples, or for which the
+ * fit is degenerate, yield 0.
+ */
+void fastnurealspectrogram(Real *tptr, Real *xptr, int *nptr, double *lengthptr, int *ncoeffptr, int *noctaveptr,
+			   Real *omegamaxptr, Real *winlenptr, Real *hopptr, int *nwinptr, Complex *result)
+{   int     i, j, k, l, lmax, m, wb, nb, nbtot, cnt, w,
+	    n = *nptr, ncoeff = *ncoeffptr, noctave = *noctaveptr, nwin = *nwinptr,
+	    nfreq = ncoeff*noctave,
+	    *cnts;				/* sample count of each window */
+    Real    omegamax = *omegamaxptr, omegaoct, omega, omul = exp(-M_LN2/ncoeff),
+	    hop = *hopptr,
+	    mu = (0.5*M_PI)/ *lengthptr,
+	    bw,					/* width of the finest blocks */
+	    wbd, nbd, nwd,			/* window length, total number of blocks and of windows */
+	    tmin, tmax, dtaud, tmp;
+    Complex zeta, iota, zl, il, *rp,
+	    elead, etrail, ehop;		/* phases at the window edges and their step per window */
+    XTFreq  f;
+    XTBlock *level[32];			/* blocks merged l times; lmax+1 are used */
+
+    if(n <= 0 || nwin <= 0 || !(hop > 0 && *winlenptr > 0)) return;
+    for(tmin = tmax = tptr[0], k = 1; k < n; k++)
+    {   if(tptr[k] < tmin) tmin = tptr[k];
+	if(tptr[k] > tmax) tmax = tptr[k];
+    }
+    /* Block width: hop/m with m a power of two, at most half a period of omegamax */
+    for(m = 1; hop/m > M_PI/omegamax && m < INT_MAX/4; m *= 2);
+    bw = hop/m;
+    if(!((wbd = floor(*winlenptr/bw+0.5)) >= 1)) wbd = 1;
+    nbd = floor((tmax-tmin)/bw)+1;
+    /* No more windows than fit into the data with the rounded length; at least one */
+    if(!((nwd = floor((nbd-wbd)/m)+1) >= 1)) nwd = 1;
+    if(nwd < nwin) *nwinptr = nwin = (int)nwd;
+    if(!(nbd >= (Real)m*(nwin-1)+wbd)) nbd = (Real)m*(nwin-1)+wbd;
+    if(!(nbd < INT_MAX/2)) return;	/* block indices would not fit into an int */
+    wb = (int)wbd; nbtot = (int)nbd;
+    *winlenptr = wb*bw;
+    /* Merged blocks are used as long as they divide hop and window length */
+    for(lmax = 0; lmax+1 < noctave && lmax+1 < 32 && !(m & ((2<<lmax)-1)) && !(wb & ((2<<lmax)-1)); lmax++);
+
+    if(!(level[0] = xtsubdivide(tptr, xptr, n, tmin, tmin+(nbtot-0.5)*bw, 0.5*bw, mu, &nb)))
+	return;
+    for(l = 1; l <= lmax; l++)
+	if((level[l] = malloc(nb*sizeof(XTBlock))))
+	{   memcpy(level[l], level[l-1], nb*sizeof(XTBlock));
+	    nb = xtmerge(level[l], nb, bw*(1 << (l-1))*0.5, mu);
+	}
+	else
+	{   lmax = l-1; break;   }
+
+    /* Sample counts per window */
+    if((cnts = malloc(nwin*sizeof(int))))
+    {   for(cnt = 0, i = 0; i < wb; i++) cnt += level[0][i].cnt;
+	for(cnts[0] = cnt, w = 1; w < nwin; w++)
+	{   for(i = (w-1)*m; i < w*m; i++) cnt += level[0][i+wb].cnt-level[0][i].cnt;
+	    cnts[w] = cnt;
+	}
+
+	/*** Loop over Octaves ***/
+	for(j = 0, omegaoct = omegamax; j < noctave; j++, omegaoct *= 0.5)
+	{   l = j < lmax ? j : lmax;
+	    dtaud = bw*(1 << l)*0.5;
+	    /*** Results per frequency, running over the windows ***/
+	    for(i = 0, omega = omegaoct; i < ncoeff; i++, omega *= omul)
+	    {   zeta = iota = 0;
+		rp = result+j*ncoeff+i;
+		xtfreq(&f, omega, dtaud, mu);
+		/* phases of the first block of the window and of the first block after it;
+		 * both advance by exp(-i omega hop) per window */
+		PHISET(etrail, -omega*(tmin+dtaud));
+		PHISET(elead, -omega*(tmin+(2*(wb >> l)+1)*dtaud));
+		PHISET(ehop, -omega*hop);
+		xtsum(level[l], wb >> l, etrail, &f, &zeta, &iota);
+		for(w = 0; ; )
+		{   /* the running sums do not cancel exactly, so degenerate windows are caught here */
+		    *rp = cnts[w] > 1 && 1-(sqr(RE(iota))+sqr(IM(iota)))/sqr(cnts[w]) > 0 ?
+			  xtrealcoeff(zeta, iota, cnts[w]) : 0;
+		    if(++w >= nwin) break;
+		    rp += nfreq;
+		    /* leading edge */
+		    xtsum(level[l]+(((w-1)*m+wb) >> l), m >> l, elead, &f, &zeta, &iota);
+		    /* trailing edge */
+		    zl = il = 0;
+		    xtsum(level[l]+(((w-1)*m) >> l), m >> l, etrail, &f, &zl, &il);
+		    zeta -= zl; iota -= il;
+		    elead *= ehop; etrail *= ehop;
+		}
+	    }
+	}
+	free(cnts);
+    }
+    for(l = 0; l <= lmax; l++) free(level[l]);
+}
+
 #ifdef _STANDALONE_
 
 static Data *free_data = 0;